@@ -0,0 +1,829 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// io_uring is opt-in: define CRYPTOPALS_USE_IO_URING and link with -luring.
+// otherwise (or if liburing isnt installed) we use the thread pool reader.
+#if defined(__linux__) && defined(__has_include) && defined(CRYPTOPALS_USE_IO_URING)
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define CRYPTOPALS_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifndef ASYNC_INGEST_HPP
+#define ASYNC_INGEST_HPP
+
+/**
+ *  @brief a group of newline-separated records read out of one input file
+ *
+ *  @details records come out in file order for any given source, but batches
+ *      from different files are interleaved however the reads happen to finish.
+ *
+ *      if error is non-empty, the source couldnt be opened or a read on it
+ *      failed. that batch has no records and is the last one for that source,
+ *      anything read from it before the failure has already been handed out.
+ */
+struct RecordBatch
+{
+    std::string source;
+    std::vector<std::string> records;
+    std::string error;
+};
+
+/**
+ *  @brief bounded, blocking queue of record batches
+ *
+ *  @details push() blocks while the queue is full, which is what keeps the
+ *      reader from running arbitrarily far ahead of whoever is decoding.
+ *      once close() is called, push() drops everything and pop() drains what
+ *      is left and then returns false.
+ */
+class BatchQueue
+{
+public:
+    explicit BatchQueue( size_t capacity )
+        : m_capacity( capacity ), m_closed( false )
+    {
+        if ( capacity == 0 )
+        {
+            throw std::runtime_error( "BatchQueue(): Capacity must be nonzero" );
+        }
+    }
+
+    /**
+     *  @brief adds a batch, waiting for room if the queue is full
+     *
+     *  @param [in] batch batch to add
+     *  @return false if the queue was closed and the batch was dropped
+     *
+     *  @details n/a
+     */
+    bool push( RecordBatch batch )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+
+        m_notFull.wait( lock, [this] { return m_closed || m_batches.size() < m_capacity; } );
+
+        if ( m_closed )
+        {
+            return false;
+        }
+
+        m_batches.push_back( std::move(batch) );
+        m_notEmpty.notify_one();
+
+        return true;
+    }
+
+    /**
+     *  @brief takes the oldest batch, waiting for one if the queue is empty
+     *
+     *  @param [out] batch where to put the batch
+     *  @return false once the queue is closed and empty
+     *
+     *  @details n/a
+     */
+    bool pop( RecordBatch& batch )
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+
+        m_notEmpty.wait( lock, [this] { return m_closed || !m_batches.empty(); } );
+
+        if ( m_batches.empty() )
+        {
+            return false;
+        }
+
+        batch = std::move( m_batches.front() );
+        m_batches.pop_front();
+        m_notFull.notify_one();
+
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+
+        m_closed = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    size_t m_capacity;
+    bool m_closed;
+    std::deque<RecordBatch> m_batches;
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+};
+
+namespace ingest_detail
+{
+
+/**
+ *  @brief something that can have positional reads in flight and tell us when
+ *      each of them is done
+ *
+ *  @details results follow the io_uring convention: bytes read, 0 at eof, or
+ *      -errno on failure. tag is whatever the caller passed to submit().
+ */
+class BlockReader
+{
+public:
+    virtual ~BlockReader() = default;
+
+    virtual void submit( size_t tag, int fd, char* buf, size_t len, off_t offset ) = 0;
+    virtual void wait( size_t& tag, ssize_t& result ) = 0;
+};
+
+/**
+ *  @brief fallback reader, a handful of threads doing blocking preadv() calls
+ *
+ *  @details n/a
+ */
+class ThreadPoolReader : public BlockReader
+{
+public:
+    explicit ThreadPoolReader( size_t numThreads )
+        : m_stopping( false )
+    {
+        for ( size_t i = 0; i < numThreads; ++i )
+        {
+            m_workers.emplace_back( [this] { work(); } );
+        }
+    }
+
+    ~ThreadPoolReader() override
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+
+        m_hasRequest.notify_all();
+
+        for ( auto& worker : m_workers )
+        {
+            worker.join();
+        }
+    }
+
+    void submit( size_t tag, int fd, char* buf, size_t len, off_t offset ) override
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_requests.push_back( Request { tag, fd, buf, len, offset } );
+        }
+
+        m_hasRequest.notify_one();
+    }
+
+    void wait( size_t& tag, ssize_t& result ) override
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+
+        m_hasCompletion.wait( lock, [this] { return !m_completions.empty(); } );
+
+        tag = m_completions.front().first;
+        result = m_completions.front().second;
+        m_completions.pop_front();
+    }
+
+private:
+    struct Request
+    {
+        size_t tag;
+        int fd;
+        char* buf;
+        size_t len;
+        off_t offset;
+    };
+
+    void work()
+    {
+        for ( ;; )
+        {
+            Request request {};
+
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+
+                m_hasRequest.wait( lock, [this] { return m_stopping || !m_requests.empty(); } );
+
+                if ( m_requests.empty() )
+                {
+                    return;
+                }
+
+                request = m_requests.front();
+                m_requests.pop_front();
+            }
+
+            iovec iov { request.buf, request.len };
+            ssize_t result;
+
+            do
+            {
+                result = ::preadv( request.fd, &iov, 1, request.offset );
+            }
+            while ( result < 0 && errno == EINTR );
+
+            if ( result < 0 )
+            {
+                result = -errno;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                m_completions.emplace_back( request.tag, result );
+            }
+
+            m_hasCompletion.notify_one();
+        }
+    }
+
+    bool m_stopping;
+    std::deque<Request> m_requests;
+    std::deque<std::pair<size_t, ssize_t>> m_completions;
+    std::mutex m_mutex;
+    std::condition_variable m_hasRequest;
+    std::condition_variable m_hasCompletion;
+    std::vector<std::thread> m_workers;
+};
+
+#ifdef CRYPTOPALS_HAVE_IO_URING
+
+/**
+ *  @brief reader backed by an io_uring submission/completion ring
+ *
+ *  @details throws std::runtime_error from the constructor if the kernel wont
+ *      give us a ring (too old, blocked by seccomp, etc.). reads go through
+ *      IORING_OP_READV rather than IORING_OP_READ, since plain READ only showed
+ *      up in 5.6 and a 5.1-5.5 kernel would hand us a ring and then fail every
+ *      read with -EINVAL. tags must be less than entries, each one gets its own
+ *      iovec that has to stay put until the read completes.
+ */
+class UringReader : public BlockReader
+{
+public:
+    explicit UringReader( unsigned entries )
+        : m_iovecs( entries )
+    {
+        int rc = io_uring_queue_init( entries, &m_ring, 0 );
+
+        if ( rc < 0 )
+        {
+            throw std::runtime_error( std::string("UringReader(): io_uring_queue_init failed: ") + std::strerror(-rc) );
+        }
+    }
+
+    ~UringReader() override
+    {
+        io_uring_queue_exit( &m_ring );
+    }
+
+    void submit( size_t tag, int fd, char* buf, size_t len, off_t offset ) override
+    {
+        if ( tag >= m_iovecs.size() )
+        {
+            throw std::runtime_error( "UringReader::submit(): Tag out of range" );
+        }
+
+        io_uring_sqe* sqe = io_uring_get_sqe( &m_ring );
+
+        if ( sqe == nullptr )
+        {
+            throw std::runtime_error( "UringReader::submit(): Submission queue is full" );
+        }
+
+        m_iovecs[tag].iov_base = buf;
+        m_iovecs[tag].iov_len = len;
+
+        io_uring_prep_readv( sqe, fd, &m_iovecs[tag], 1, offset );
+        io_uring_sqe_set_data( sqe, reinterpret_cast<void*>(tag) );
+
+        int rc = io_uring_submit( &m_ring );
+
+        if ( rc < 0 )
+        {
+            throw std::runtime_error( std::string("UringReader::submit(): io_uring_submit failed: ") + std::strerror(-rc) );
+        }
+    }
+
+    void wait( size_t& tag, ssize_t& result ) override
+    {
+        io_uring_cqe* cqe = nullptr;
+        int rc;
+
+        do
+        {
+            rc = io_uring_wait_cqe( &m_ring, &cqe );
+        }
+        while ( rc == -EINTR );
+
+        if ( rc < 0 )
+        {
+            throw std::runtime_error( std::string("UringReader::wait(): io_uring_wait_cqe failed: ") + std::strerror(-rc) );
+        }
+
+        tag = reinterpret_cast<size_t>( io_uring_cqe_get_data(cqe) );
+        result = cqe->res;
+
+        io_uring_cqe_seen( &m_ring, cqe );
+    }
+
+private:
+    io_uring m_ring;
+    std::vector<iovec> m_iovecs;
+};
+
+#endif
+
+/**
+ *  @brief cuts a stream of blocks into lines
+ *
+ *  @details lines are split on '\n', a trailing '\r' is dropped, and empty lines
+ *      are skipped. a partial line stays in carry until the rest of it shows up.
+ *      we remember how far into carry we already looked for a newline, so a line
+ *      that spans lots of blocks only gets scanned once, and consumed lines are
+ *      only erased from the front once they make up over half of carry. both of
+ *      those keep a really long line from turning into quadratic work.
+ */
+class LineSplitter
+{
+public:
+    /**
+     *  @brief adds a block and moves any lines it completes into records
+     *
+     *  @param [in]  data    block contents
+     *  @param [in]  len     number of bytes in the block
+     *  @param [out] records where to append the lines
+     *
+     *  @details n/a
+     */
+    void feed( char const* data, size_t len, std::vector<std::string>& records )
+    {
+        m_carry.append( data, len );
+
+        for ( ;; )
+        {
+            size_t end = m_carry.find( '\n', m_scanned );
+
+            if ( end == std::string::npos )
+            {
+                m_scanned = m_carry.size();
+                break;
+            }
+
+            emit( end, records );
+            m_consumed = end + 1;
+            m_scanned = m_consumed;
+        }
+
+        if ( m_consumed > m_carry.size() / 2 )
+        {
+            m_carry.erase( 0, m_consumed );
+            m_scanned -= m_consumed;
+            m_consumed = 0;
+        }
+    }
+
+    /**
+     *  @brief flushes whatever is left as the last line, for when we hit eof
+     *
+     *  @param [out] records where to append the line
+     *
+     *  @details n/a
+     */
+    void finish( std::vector<std::string>& records )
+    {
+        emit( m_carry.size(), records );
+        reset();
+    }
+
+    void reset()
+    {
+        m_carry.clear();
+        m_scanned = 0;
+        m_consumed = 0;
+    }
+
+private:
+    void emit( size_t end, std::vector<std::string>& records )
+    {
+        size_t len = end - m_consumed;
+
+        if ( len > 0 && m_carry[m_consumed + len - 1] == '\r' )
+        {
+            --len;
+        }
+
+        if ( len > 0 )
+        {
+            records.emplace_back( m_carry, m_consumed, len );
+        }
+    }
+
+    std::string m_carry;
+    size_t m_scanned = 0;
+    size_t m_consumed = 0;
+};
+
+/**
+ *  @brief picks io_uring when it is compiled in and the kernel lets us have it,
+ *      otherwise the thread pool
+ *
+ *  @param [in] inFlight max number of reads that will be outstanding at once
+ *  @return reader to use
+ *
+ *  @details n/a
+ */
+std::unique_ptr<BlockReader> makeBlockReader( size_t inFlight )
+{
+#ifdef CRYPTOPALS_HAVE_IO_URING
+    try
+    {
+        return std::unique_ptr<BlockReader>( new UringReader( static_cast<unsigned>(inFlight) ) );
+    }
+    catch ( std::runtime_error const& )
+    {
+        // fall through to the thread pool
+    }
+#endif
+
+    return std::unique_ptr<BlockReader>( new ThreadPoolReader( inFlight ) );
+}
+
+} // namespace ingest_detail
+
+/**
+ *  @brief knobs for AsyncIngest
+ *
+ *  @details n/a
+ */
+struct IngestOptions
+{
+    size_t inFlight     = 16;        // reads outstanding at once, across all files
+    size_t maxOpenFiles = 8;         // files being read (or waited on) at once
+    size_t blockSize    = 64 * 1024; // bytes per read
+    size_t queueDepth   = 16;        // batches buffered ahead of the consumer
+};
+
+/**
+ *  @brief reads a list of files in the background and hands their lines out as
+ *      batches, so the disk and the decode/score stages run at the same time
+ *
+ *  @details a background thread keeps up to inFlight block-sized reads
+ *      outstanding. they go to the current file at increasing offsets until
+ *      every block of it has been submitted, then to the next file (up to
+ *      maxOpenFiles at once), so a single big file keeps the disk just as busy
+ *      as lots of small ones. blocks can land out of order, so each file holds
+ *      on to early ones until the blocks before them show up, and then the
+ *      complete lines become a batch on a bounded queue. a buffer only goes
+ *      back into rotation once its block has been split, and if the consumer
+ *      falls behind the queue fills up and the reader stops submitting until
+ *      there is room again.
+ *
+ *      files are read up to the size they had when they were opened, so this
+ *      is meant for regular files, not pipes or anything still being written.
+ *
+ *      see LineSplitter for how lines get split. usage:
+ *
+ *          AsyncIngest ingest( paths );
+ *          RecordBatch batch;
+ *          while ( ingest.next(batch) ) { ... }
+ */
+class AsyncIngest
+{
+public:
+    explicit AsyncIngest( std::vector<std::string> paths, IngestOptions options = IngestOptions() )
+        : m_paths( std::move(paths) ),
+          m_options( options ),
+          m_queue( options.queueDepth ),
+          m_stopping( false )
+    {
+        if ( m_options.inFlight == 0 || m_options.maxOpenFiles == 0 || m_options.blockSize == 0 )
+        {
+            throw std::runtime_error( "AsyncIngest(): inFlight, maxOpenFiles and blockSize must be nonzero" );
+        }
+
+        m_thread = std::thread( [this] { run(); } );
+    }
+
+    AsyncIngest( AsyncIngest const& ) = delete;
+    AsyncIngest& operator=( AsyncIngest const& ) = delete;
+
+    ~AsyncIngest()
+    {
+        m_stopping = true;
+        m_queue.close();
+        m_thread.join();
+    }
+
+    /**
+     *  @brief gets the next batch of records
+     *
+     *  @param [out] batch where to put the batch
+     *  @return false once every file has been read
+     *
+     *  @details a file that cant be opened or read doesnt stop the others, it
+     *      just shows up as a batch with error set (see RecordBatch). this only
+     *      throws if the reader itself broke (couldnt submit a read, etc.), and
+     *      then only after every batch queued before that has been handed out.
+     */
+    bool next( RecordBatch& batch )
+    {
+        if ( m_queue.pop(batch) )
+        {
+            return true;
+        }
+
+        if ( m_error )
+        {
+            std::rethrow_exception( m_error );
+        }
+
+        return false;
+    }
+
+private:
+    struct OpenFile
+    {
+        std::string path;
+        int fd = -1;
+        off_t size = 0;         // bytes to read, from fstat() (less if a read comes up short)
+        off_t nextOffset = 0;   // offset of the next block to submit
+        off_t delivered = 0;    // everything before this has been fed to lines
+        size_t outstanding = 0; // reads submitted but not completed yet
+        std::map<off_t, std::pair<size_t, ssize_t>> ready; // early blocks: offset -> (tag, result)
+        std::string error;
+        ingest_detail::LineSplitter lines;
+    };
+
+    void run()
+    {
+        size_t const blockSize = m_options.blockSize;
+
+        // one buffer per tag. a tag is free once the block in its buffer has
+        // been split into lines, not just once the read completes.
+        std::vector<char> buffers( m_options.inFlight * blockSize );
+        std::vector<OpenFile*> tagFile( m_options.inFlight, nullptr );
+        std::vector<off_t> tagOffset( m_options.inFlight, 0 );
+        std::vector<size_t> freeTags;
+
+        for ( size_t tag = m_options.inFlight; tag > 0; --tag )
+        {
+            freeTags.push_back( tag - 1 );
+        }
+
+        std::vector<std::unique_ptr<OpenFile>> files;
+        size_t outstanding = 0;
+        size_t nextPath = 0;
+
+        try
+        {
+            std::unique_ptr<ingest_detail::BlockReader> reader = ingest_detail::makeBlockReader( m_options.inFlight );
+
+            // opens the next file that has something in it. files that wont open
+            // get reported and skipped. returns false once we are out of files.
+            auto openNext = [&]() -> bool
+            {
+                while ( nextPath < m_paths.size() && !m_stopping )
+                {
+                    std::string path = m_paths[nextPath++];
+                    int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+                    struct stat st {};
+
+                    if ( fd < 0 || ::fstat( fd, &st ) < 0 )
+                    {
+                        m_queue.push( RecordBatch { path, {}, std::string("Unable to open file: ") + std::strerror(errno) } );
+
+                        if ( fd >= 0 )
+                        {
+                            ::close( fd );
+                        }
+
+                        continue;
+                    }
+
+                    if ( st.st_size == 0 )
+                    {
+                        ::close( fd );
+                        continue;
+                    }
+
+                    files.emplace_back( new OpenFile );
+                    files.back()->path = path;
+                    files.back()->fd = fd;
+                    files.back()->size = st.st_size;
+
+                    return true;
+                }
+
+                return false;
+            };
+
+            // hands free buffers out to whichever file still has blocks left to
+            // submit, opening more files as the earlier ones run out
+            auto fill = [&]()
+            {
+                while ( !freeTags.empty() && !m_stopping )
+                {
+                    OpenFile* target = nullptr;
+
+                    for ( auto& file : files )
+                    {
+                        if ( file->error.empty() && file->nextOffset < file->size )
+                        {
+                            target = file.get();
+                            break;
+                        }
+                    }
+
+                    if ( target == nullptr )
+                    {
+                        if ( files.size() < m_options.maxOpenFiles && openNext() )
+                        {
+                            continue;
+                        }
+
+                        break;
+                    }
+
+                    size_t tag = freeTags.back();
+                    freeTags.pop_back();
+
+                    tagFile[tag] = target;
+                    tagOffset[tag] = target->nextOffset;
+
+                    reader->submit( tag, target->fd, buffers.data() + tag * blockSize, blockSize, target->nextOffset );
+
+                    target->nextOffset += blockSize;
+                    ++target->outstanding;
+                    ++outstanding;
+                }
+            };
+
+            try
+            {
+                fill();
+
+                while ( outstanding > 0 )
+                {
+                    size_t tag;
+                    ssize_t result;
+
+                    reader->wait( tag, result );
+                    --outstanding;
+
+                    OpenFile& file = *tagFile[tag];
+                    off_t offset = tagOffset[tag];
+
+                    --file.outstanding;
+
+                    if ( m_stopping )
+                    {
+                        freeTags.push_back( tag );
+                        continue;
+                    }
+
+                    if ( result < 0 )
+                    {
+                        if ( file.error.empty() )
+                        {
+                            file.error = std::string("Read failed: ") + std::strerror( static_cast<int>(-result) );
+                        }
+
+                        freeTags.push_back( tag );
+                    }
+                    else
+                    {
+                        // a short read means the file got shorter since we opened it
+                        if ( static_cast<size_t>(result) < blockSize && offset + result < file.size )
+                        {
+                            file.size = offset + result;
+                        }
+
+                        file.ready[offset] = std::make_pair( tag, result );
+                    }
+
+                    RecordBatch batch { file.path, {}, "" };
+
+                    // feed the splitter whatever is now contiguous from where we
+                    // left off. later blocks keep waiting in ready.
+                    auto it = file.ready.begin();
+
+                    while ( file.error.empty() && it != file.ready.end() && it->first == file.delivered && file.delivered < file.size )
+                    {
+                        size_t len = std::min( static_cast<size_t>(it->second.second), static_cast<size_t>(file.size - file.delivered) );
+
+                        file.lines.feed( buffers.data() + it->second.first * blockSize, len, batch.records );
+                        freeTags.push_back( it->second.first );
+
+                        file.delivered += blockSize;
+                        it = file.ready.erase( it );
+                    }
+
+                    bool finished = (file.outstanding == 0) && (!file.error.empty() || file.delivered >= file.size);
+
+                    if ( finished )
+                    {
+                        if ( file.error.empty() )
+                        {
+                            // whatever is left over is the last line of the file,
+                            // it just didnt have a newline after it
+                            file.lines.finish( batch.records );
+                        }
+                        else
+                        {
+                            batch.error = file.error;
+                        }
+
+                        // blocks past a failed read (or past a short one) never
+                        // get delivered, so just take their buffers back
+                        for ( auto const& block : file.ready )
+                        {
+                            freeTags.push_back( block.second.first );
+                        }
+
+                        ::close( file.fd );
+
+                        for ( size_t i = 0; i < files.size(); ++i )
+                        {
+                            if ( files[i].get() == &file )
+                            {
+                                files.erase( files.begin() + i );
+                                break;
+                            }
+                        }
+                    }
+
+                    // get the freed buffers reading again before we (maybe) block
+                    // on the queue, so the disk keeps busy while the consumer
+                    // catches up
+                    fill();
+
+                    if ( !batch.records.empty() || !batch.error.empty() )
+                    {
+                        m_queue.push( std::move(batch) );
+                    }
+                }
+            }
+            catch ( ... )
+            {
+                // the reader cant go away while it still has reads pointed at our
+                // buffers, so let those finish before unwinding
+                while ( outstanding > 0 )
+                {
+                    size_t tag;
+                    ssize_t result;
+
+                    reader->wait( tag, result );
+                    --outstanding;
+                }
+
+                throw;
+            }
+        }
+        catch ( ... )
+        {
+            m_error = std::current_exception();
+        }
+
+        for ( auto& file : files )
+        {
+            if ( file->fd >= 0 )
+            {
+                ::close( file->fd );
+            }
+        }
+
+        m_queue.close();
+    }
+
+    std::vector<std::string> m_paths;
+    IngestOptions m_options;
+    BatchQueue m_queue;
+    std::atomic<bool> m_stopping;
+    std::exception_ptr m_error;
+    std::thread m_thread;
+};
+
+#endif
@@ -1,48 +1,25 @@
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "kernels.hpp"
+
 #ifndef CONVERSIONS_HPP
 #define CONVERSIONS_HPP
 
-/**
- *  @brief Converts a hex char (0-f) to its numerical value. Case-insensitive
- *  
- *  @param [in] c `char` with a value of [0-9a-fA-F]
- *  @return numerical representation of hex character
- *  
- *  @details throws std::runtime_error on bad input
- */
-uint8_t decodeHexChar( char c )
-{
-    if ( c >= '0' && c <= '9' )
-    {
-        return (c - '0');
-    }
-    else if ( c >= 'a' && c <= 'f' )
-    {
-        // add 10 to adjust for the fact that a=10, b=11, etc.
-        return (c - 'a') + 10;
-    }
-    else if ( c >= 'A' && c <= 'F' )
-    {
-        // add 10 to adjust for the fact that a=10, b=11, etc.
-        return (c - 'A') + 10;
-    }
-    else
-    {
-        throw std::runtime_error( "decodeHexChar(): Invalid char: " + static_cast<int>(c) );
-    }
-}
-
 /**
  *  @brief Converts hex string (case-insensitive) to byte array
  *  
  *  @param [in] hexString case-inensitive hex string
  *  @return byte array (std::vector<uint8_t>)
  *  
- *  @details n/a
+ *  @details throws std::runtime_error on bad input
  */
 std::vector<uint8_t> hex2bin( std::string const hexString )
 {
@@ -57,17 +34,11 @@ std::vector<uint8_t> hex2bin( std::string const hexString )
         throw std::runtime_error( "hex2bin(): Invalid hexstring length" );
     }
     
-    std::vector<uint8_t> data {};
+    std::vector<uint8_t> data( hexString.length()/2 );
     
-    for ( int i = 0; i < hexString.length()/2; ++i )
-    {
-        int offset = i * 2;
-        
-        uint8_t hexByte = decodeHexChar( hexString[offset] ) << 4;
-        hexByte += decodeHexChar( hexString[offset+1] );
-        
-        data.push_back( hexByte );
-    }
+    // the actual decoding loop lives in kernels.hpp, which picks the fastest
+    // variant for this input size
+    kernels().hex2bin.select( data.size() )( hexString.data(), data.size(), data.data() );
     
     return data;
 }
@@ -138,40 +109,208 @@ std::string bin2hex( std::vector<uint8_t> const data )
 }
 
 /**
- *  @brief Converts byte array to ASCII string
+ *  @brief how non-printable bytes get rendered by renderPrintable()
  *  
- *  @param [in] data byte array to convert
- *  @param [in] safe if true, replace non-printable byte values with a printable ascii char
- *  @return Return description
+ *  @details Currency writes "¤" (2 bytes of utf-8), Hex writes "\xNN" (4 bytes)
+ *      and Dot writes "." (1 byte). printable means ' ' through '~'.
+ */
+enum class EscapeStyle
+{
+    Currency,
+    Hex,
+    Dot
+};
+
+/**
+ *  @brief number of output bytes a single non-printable byte expands to
+ *  
+ *  @param [in] style escape style to look up
+ *  @return width of the escape sequence in bytes
  *  
  *  @details n/a
  */
-std::string bin2ascii( std::vector<uint8_t> const data, bool safe )
+size_t escapeWidth( EscapeStyle style )
 {
-    std::string output {};
+    switch ( style )
+    {
+        case EscapeStyle::Currency: return 2;
+        case EscapeStyle::Hex:      return 4;
+        case EscapeStyle::Dot:      return 1;
+    }
     
-    for ( int i = 0; i < data.size(); ++i )
+    return 1;
+}
+
+/**
+ *  @brief counts the bytes in a buffer that fall outside of ' ' through '~'
+ *  
+ *  @param [in] data pointer to the bytes to classify
+ *  @param [in] len  number of bytes
+ *  @return count of non-printable bytes
+ *  
+ *  @details uses sse2 when the compiler has it, 16 bytes at a time. bytes >= 0x80
+ *      are negative as signed chars, so two signed compares (> 0x1f and < 0x7f)
+ *      are enough to build the printable mask.
+ */
+size_t countNonPrintable( uint8_t const* data, size_t len )
+{
+    size_t count = 0;
+    size_t i = 0;
+    
+#ifdef __SSE2__
+    __m128i const lo = _mm_set1_epi8( 0x1f );
+    __m128i const hi = _mm_set1_epi8( 0x7f );
+    
+    for ( ; i + 16 <= len; i += 16 )
+    {
+        __m128i chunk = _mm_loadu_si128( reinterpret_cast<__m128i const*>(data + i) );
+        __m128i printable = _mm_and_si128( _mm_cmpgt_epi8(chunk, lo), _mm_cmplt_epi8(chunk, hi) );
+        
+        // movemask gives one bit per printable byte, so flip it to count the others
+        unsigned mask = ~static_cast<unsigned>( _mm_movemask_epi8(printable) ) & 0xFFFF;
+        count += __builtin_popcount( mask );
+    }
+#endif
+    
+    for ( ; i < len; ++i )
     {
         if ( data[i] < ' ' || data[i] > '~' )
         {
-            if ( safe )
-            {
-                output += "¤";
-            }
-            else
+            ++count;
+        }
+    }
+    
+    return count;
+}
+
+/**
+ *  @brief exact number of bytes renderPrintable() will write for a buffer
+ *  
+ *  @param [in] data  pointer to the bytes to render
+ *  @param [in] len   number of bytes
+ *  @param [in] style escape style for non-printable bytes
+ *  @return size of the rendered output, in bytes
+ *  
+ *  @details n/a
+ */
+size_t renderedSize( uint8_t const* data, size_t len, EscapeStyle style )
+{
+    return len + countNonPrintable( data, len ) * (escapeWidth( style ) - 1);
+}
+
+/**
+ *  @brief renders a byte buffer as printable ascii into a preallocated buffer
+ *  
+ *  @param [in]  data  pointer to the bytes to render
+ *  @param [in]  len   number of bytes
+ *  @param [in]  style escape style for non-printable bytes
+ *  @param [out] out   destination, must hold at least renderedSize() bytes
+ *  @return number of bytes written to out
+ *  
+ *  @details runs of 16 printable bytes get copied straight across, everything
+ *      else falls back to the byte-at-a-time path.
+ */
+size_t renderPrintable( uint8_t const* data, size_t len, EscapeStyle style, char* out )
+{
+    static char const hexDigits[] { "0123456789abcdef" };
+    
+    char* cursor = out;
+    size_t i = 0;
+    
+    while ( i < len )
+    {
+#ifdef __SSE2__
+        if ( i + 16 <= len )
+        {
+            __m128i chunk = _mm_loadu_si128( reinterpret_cast<__m128i const*>(data + i) );
+            __m128i printable = _mm_and_si128( _mm_cmpgt_epi8(chunk, _mm_set1_epi8(0x1f)),
+                                               _mm_cmplt_epi8(chunk, _mm_set1_epi8(0x7f)) );
+            
+            if ( _mm_movemask_epi8(printable) == 0xFFFF )
             {
-                output += data[i];
+                std::memcpy( cursor, data + i, 16 );
+                cursor += 16;
+                i += 16;
+                continue;
             }
         }
-        else
+#endif
+        
+        // either we dont have sse2, we are at the tail, or this chunk has
+        // something in it that needs escaping. do the next 16 bytes by hand.
+        size_t end = (i + 16 < len) ? i + 16 : len;
+        
+        for ( ; i < end; ++i )
         {
-            output += static_cast<char>( data[i] );
+            uint8_t b = data[i];
+            
+            if ( b >= ' ' && b <= '~' )
+            {
+                *cursor++ = static_cast<char>( b );
+                continue;
+            }
+            
+            switch ( style )
+            {
+                case EscapeStyle::Currency:
+                    // "¤" is U+00A4, which is 0xC2 0xA4 in utf-8
+                    *cursor++ = static_cast<char>( 0xC2 );
+                    *cursor++ = static_cast<char>( 0xA4 );
+                    break;
+                case EscapeStyle::Hex:
+                    *cursor++ = '\\';
+                    *cursor++ = 'x';
+                    *cursor++ = hexDigits[(b >> 4) & 0x0F];
+                    *cursor++ = hexDigits[b & 0x0F];
+                    break;
+                case EscapeStyle::Dot:
+                    *cursor++ = '.';
+                    break;
+            }
         }
     }
     
+    return cursor - out;
+}
+
+/**
+ *  @brief renders a byte array as a printable ascii string
+ *  
+ *  @param [in] data  byte array to render
+ *  @param [in] style escape style for non-printable bytes
+ *  @return printable string representation of data
+ *  
+ *  @details sizes the string exactly up front, so there is only ever one allocation
+ */
+std::string renderPrintable( std::vector<uint8_t> const& data, EscapeStyle style )
+{
+    std::string output( renderedSize( data.data(), data.size(), style ), '\0' );
+    
+    renderPrintable( data.data(), data.size(), style, &output[0] );
+    
     return output;
 }
 
+/**
+ *  @brief Converts byte array to ASCII string
+ *  
+ *  @param [in] data byte array to convert
+ *  @param [in] safe if true, replace non-printable byte values with a printable ascii char
+ *  @return Return description
+ *  
+ *  @details safe output uses "¤" for non-printables, see renderPrintable() for the
+ *      other escape styles
+ */
+std::string bin2ascii( std::vector<uint8_t> const data, bool safe )
+{
+    if ( safe )
+    {
+        return renderPrintable( data, EscapeStyle::Currency );
+    }
+    
+    return std::string( data.begin(), data.end() );
+}
+
 /**
  *  @brief Converts ASCII string to byte array
  *  
@@ -0,0 +1,429 @@
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+
+/**
+ *  @brief upper bound (inclusive) of each input size bucket, in bytes
+ *
+ *  @details every tunable primitive keeps one variant choice per bucket. the
+ *      last bucket catches everything bigger than the one before it.
+ */
+static size_t const kernelSizeBuckets[] { 64, 1024, 16 * 1024, std::numeric_limits<size_t>::max() };
+static size_t const numKernelSizeBuckets = sizeof(kernelSizeBuckets) / sizeof(kernelSizeBuckets[0]);
+
+/**
+ *  @brief finds which size bucket an input length falls into
+ *
+ *  @param [in] n input length in bytes
+ *  @return index into kernelSizeBuckets
+ *
+ *  @details n/a
+ */
+size_t kernelSizeBucket( size_t n )
+{
+    size_t bucket = 0;
+
+    while ( n > kernelSizeBuckets[bucket] )
+    {
+        ++bucket;
+    }
+
+    return bucket;
+}
+
+/**
+ *  @brief input length we benchmark a bucket with
+ *
+ *  @param [in] bucket index into kernelSizeBuckets
+ *  @return size in bytes
+ *
+ *  @details the last bucket has no real upper bound, so it just gets something
+ *      big enough to fall out of L2
+ */
+size_t kernelBenchSize( size_t bucket )
+{
+    if ( bucket + 1 == numKernelSizeBuckets )
+    {
+        return 1024 * 1024;
+    }
+
+    return kernelSizeBuckets[bucket];
+}
+
+/**
+ *  @brief the type-erased side of a KernelDispatch, so the autotuner and the
+ *      profile code can walk every primitive without knowing its signature
+ *
+ *  @details n/a
+ */
+class TunablePrimitive
+{
+public:
+    virtual ~TunablePrimitive() = default;
+
+    virtual std::string const& name() const = 0;
+    virtual size_t numVariants() const = 0;
+    virtual std::string const& variantName( size_t variant ) const = 0;
+    virtual bool variantSupported( size_t variant ) const = 0;
+
+    /**
+     *  @brief runs one variant reps times on an input of size n
+     */
+    virtual void runBenchmark( size_t variant, size_t reps, size_t n ) const = 0;
+
+    virtual size_t choice( size_t bucket ) const = 0;
+    virtual void setChoice( size_t bucket, size_t variant ) = 0;
+
+    /**
+     *  @brief looks a variant up by name
+     *
+     *  @param [in] variant name to look for
+     *  @return variant index, or numVariants() if there is no such variant
+     *
+     *  @details n/a
+     */
+    size_t findVariant( std::string const& variant ) const
+    {
+        for ( size_t i = 0; i < numVariants(); ++i )
+        {
+            if ( variantName(i) == variant )
+            {
+                return i;
+            }
+        }
+
+        return numVariants();
+    }
+};
+
+/**
+ *  @brief a set of interchangeable implementations of one primitive, plus which
+ *      one to use for each size bucket
+ *
+ *  @details variants are expected to be registered slowest-first. until a
+ *      profile or the autotuner says otherwise, every bucket uses the last
+ *      variant the cpu actually supports.
+ */
+template<typename Fn>
+class KernelDispatch : public TunablePrimitive
+{
+public:
+    /**
+     *  @param [in] name  primitive name, this is what shows up in profile files
+     *  @param [in] bench runs a variant reps times on an input of size n. it is
+     *      responsible for setting up its own input/output buffers.
+     */
+    KernelDispatch( std::string name, std::function<void(Fn*, size_t, size_t)> bench )
+        : m_name( std::move(name) ), m_bench( std::move(bench) )
+    {
+        for ( size_t i = 0; i < numKernelSizeBuckets; ++i )
+        {
+            m_choices[i] = 0;
+        }
+    }
+
+    /**
+     *  @brief registers a variant
+     *
+     *  @param [in] variant   name of the variant ("scalar", "sse2", ...)
+     *  @param [in] fn        the implementation
+     *  @param [in] supported false if the current cpu cant run it
+     *
+     *  @details n/a
+     */
+    void add( std::string variant, Fn* fn, bool supported = true )
+    {
+        m_variants.push_back( Variant { std::move(variant), fn, supported } );
+
+        if ( supported )
+        {
+            for ( size_t i = 0; i < numKernelSizeBuckets; ++i )
+            {
+                m_choices[i] = m_variants.size() - 1;
+            }
+        }
+    }
+
+    /**
+     *  @brief picks the implementation to use for an input of size n
+     *
+     *  @param [in] n input length in bytes
+     *  @return function pointer to call
+     *
+     *  @details n/a
+     */
+    Fn* select( size_t n ) const
+    {
+        return m_variants[m_choices[kernelSizeBucket(n)]].fn;
+    }
+
+    std::string const& name() const override { return m_name; }
+    size_t numVariants() const override { return m_variants.size(); }
+    std::string const& variantName( size_t variant ) const override { return m_variants[variant].name; }
+    bool variantSupported( size_t variant ) const override { return m_variants[variant].supported; }
+
+    void runBenchmark( size_t variant, size_t reps, size_t n ) const override
+    {
+        m_bench( m_variants[variant].fn, reps, n );
+    }
+
+    size_t choice( size_t bucket ) const override { return m_choices[bucket]; }
+
+    void setChoice( size_t bucket, size_t variant ) override
+    {
+        if ( variant >= m_variants.size() || !m_variants[variant].supported )
+        {
+            throw std::runtime_error( "KernelDispatch::setChoice(): Unusable variant for " + m_name );
+        }
+
+        m_choices[bucket] = variant;
+    }
+
+private:
+    struct Variant
+    {
+        std::string name;
+        Fn* fn;
+        bool supported;
+    };
+
+    std::string m_name;
+    std::function<void(Fn*, size_t, size_t)> m_bench;
+    std::vector<Variant> m_variants;
+    size_t m_choices[numKernelSizeBuckets];
+};
+
+/**
+ *  @brief times one variant of a primitive on an input of size n
+ *
+ *  @param [in] primitive primitive to benchmark
+ *  @param [in] variant   index of the variant to time
+ *  @param [in] n         input size in bytes
+ *  @return best observed time per call, in nanoseconds
+ *
+ *  @details doubles the rep count until one run takes at least a couple of
+ *      milliseconds, then keeps the fastest of a few runs. taking the minimum
+ *      rather than the mean throws out the runs where we got preempted.
+ */
+double benchmarkVariant( TunablePrimitive const& primitive, size_t variant, size_t n )
+{
+    typedef std::chrono::steady_clock Clock;
+
+    auto timeRun = [&]( size_t reps ) -> double
+    {
+        Clock::time_point start = Clock::now();
+        primitive.runBenchmark( variant, reps, n );
+        return std::chrono::duration<double, std::nano>( Clock::now() - start ).count();
+    };
+
+    size_t reps = 1;
+
+    // warm up the caches (and the branch predictor) before we time anything
+    timeRun( reps );
+
+    while ( timeRun(reps) < 2e6 && reps < (size_t(1) << 30) )
+    {
+        reps *= 2;
+    }
+
+    double best = std::numeric_limits<double>::max();
+
+    for ( int trial = 0; trial < 5; ++trial )
+    {
+        double perCall = timeRun( reps ) / reps;
+
+        if ( perCall < best )
+        {
+            best = perCall;
+        }
+    }
+
+    return best;
+}
+
+/**
+ *  @brief benchmarks every supported variant of every primitive in every size
+ *      bucket, and points each bucket at the fastest one
+ *
+ *  @param [in] primitives primitives to tune
+ *  @param [in] log        if not null, gets one line per measurement
+ *
+ *  @details n/a
+ */
+void autotuneKernels( std::vector<TunablePrimitive*> const& primitives, std::ostream* log = nullptr )
+{
+    for ( auto primitive : primitives )
+    {
+        for ( size_t bucket = 0; bucket < numKernelSizeBuckets; ++bucket )
+        {
+            size_t n = kernelBenchSize( bucket );
+            double bestTime = std::numeric_limits<double>::max();
+            size_t bestVariant = primitive->choice( bucket );
+
+            for ( size_t variant = 0; variant < primitive->numVariants(); ++variant )
+            {
+                if ( !primitive->variantSupported(variant) )
+                {
+                    continue;
+                }
+
+                double t = benchmarkVariant( *primitive, variant, n );
+
+                if ( log != nullptr )
+                {
+                    *log << primitive->name() << " n=" << n << " " << primitive->variantName(variant)
+                         << ": " << t << " ns" << std::endl;
+                }
+
+                if ( t < bestTime )
+                {
+                    bestTime = t;
+                    bestVariant = variant;
+                }
+            }
+
+            primitive->setChoice( bucket, bestVariant );
+        }
+    }
+}
+
+/**
+ *  @brief writes the current per-bucket choices out to a profile file
+ *
+ *  @param [in] path       file to write
+ *  @param [in] primitives primitives to save
+ *
+ *  @details one line per primitive and bucket, "<primitive> <bucket> <variant>",
+ *      where bucket is the bucket's upper bound in bytes or "max" for the last one
+ */
+void saveKernelProfile( std::string const& path, std::vector<TunablePrimitive*> const& primitives )
+{
+    std::ofstream file( path );
+
+    if ( !file.is_open() )
+    {
+        throw std::runtime_error( "saveKernelProfile(): Unable to open " + path );
+    }
+
+    file << "# primitive bucket variant" << std::endl;
+
+    for ( auto primitive : primitives )
+    {
+        for ( size_t bucket = 0; bucket < numKernelSizeBuckets; ++bucket )
+        {
+            file << primitive->name() << " ";
+
+            if ( bucket + 1 == numKernelSizeBuckets )
+            {
+                file << "max";
+            }
+            else
+            {
+                file << kernelSizeBuckets[bucket];
+            }
+
+            file << " " << primitive->variantName( primitive->choice(bucket) ) << std::endl;
+        }
+    }
+}
+
+/**
+ *  @brief applies a profile written by saveKernelProfile()
+ *
+ *  @param [in] path       file to read
+ *  @param [in] primitives primitives to apply it to
+ *  @return false if the file couldnt be opened, in which case nothing changes
+ *
+ *  @details profiles get shared across machines, so entries for primitives or
+ *      variants we dont know about, or variants this cpu cant run, are skipped
+ *      and that bucket keeps its default. a line that doesnt parse at all
+ *      throws std::runtime_error, and in that case none of the file gets applied.
+ */
+bool loadKernelProfile( std::string const& path, std::vector<TunablePrimitive*> const& primitives )
+{
+    std::ifstream file( path );
+
+    if ( !file.is_open() )
+    {
+        return false;
+    }
+
+    // collect everything first and only apply it once the whole file has
+    // parsed, so a bad line cant leave us with half a profile
+    struct Entry
+    {
+        TunablePrimitive* primitive;
+        size_t bucket;
+        size_t variant;
+    };
+
+    std::vector<Entry> entries;
+    std::string line;
+
+    while ( std::getline( file, line ) )
+    {
+        if ( line.empty() || line[0] == '#' )
+        {
+            continue;
+        }
+
+        std::istringstream fields( line );
+        std::string name, bucketName, variantName;
+
+        if ( !(fields >> name >> bucketName >> variantName) )
+        {
+            throw std::runtime_error( "loadKernelProfile(): Malformed line: " + line );
+        }
+
+        size_t bucket = numKernelSizeBuckets;
+
+        for ( size_t i = 0; i < numKernelSizeBuckets; ++i )
+        {
+            bool last = (i + 1 == numKernelSizeBuckets);
+
+            if ( (last && bucketName == "max") || (!last && bucketName == std::to_string(kernelSizeBuckets[i])) )
+            {
+                bucket = i;
+            }
+        }
+
+        if ( bucket == numKernelSizeBuckets )
+        {
+            continue;
+        }
+
+        for ( auto primitive : primitives )
+        {
+            if ( primitive->name() != name )
+            {
+                continue;
+            }
+
+            size_t variant = primitive->findVariant( variantName );
+
+            if ( variant < primitive->numVariants() && primitive->variantSupported(variant) )
+            {
+                entries.push_back( Entry { primitive, bucket, variant } );
+            }
+        }
+    }
+
+    for ( auto const& entry : entries )
+    {
+        entry.primitive->setChoice( entry.bucket, entry.variant );
+    }
+
+    return true;
+}
+
+#endif
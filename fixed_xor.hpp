@@ -19,12 +19,9 @@ std::vector<uint8_t> fixedXor( std::vector<uint8_t> inp, std::vector<uint8_t> ke
         throw std::runtime_error( "fixedXor(): Input and key size must match!" );
     }
     
-    std::vector<uint8_t> cipher {};
+    std::vector<uint8_t> cipher( inp.size() );
     
-    for ( int i = 0; i < inp.size(); ++i )
-    {
-        cipher.push_back( inp[i] ^ key[i] );
-    }
+    kernels().fixedXor.select( inp.size() )( inp.data(), key.data(), inp.size(), cipher.data() );
     
     return cipher;
 }
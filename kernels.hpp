@@ -0,0 +1,309 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dispatch.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRYPTOPALS_X86_KERNELS 1
+#endif
+
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+// the raw loops behind hex2bin(), singleByteXor() and fixedXor(). each one has
+// a few interchangeable variants, and kernels() picks between them per input
+// size. see dispatch.hpp for how that choice gets made.
+
+typedef void Hex2BinKernel( char const* hex, size_t numBytes, uint8_t* out );
+typedef void SingleByteXorKernel( uint8_t const* data, size_t len, uint8_t key, uint8_t* out );
+typedef void FixedXorKernel( uint8_t const* inp, uint8_t const* key, size_t len, uint8_t* out );
+
+/**
+ *  @brief hex char to nibble value, or 0xFF if it isnt a hex char
+ *
+ *  @param [in] c char to decode
+ *  @return 0x00-0x0f, or 0xFF on bad input
+ *
+ *  @details n/a
+ */
+uint8_t hexNibbleOrInvalid( char c )
+{
+    if ( c >= '0' && c <= '9' ) { return c - '0'; }
+    if ( c >= 'a' && c <= 'f' ) { return c - 'a' + 10; }
+    if ( c >= 'A' && c <= 'F' ) { return c - 'A' + 10; }
+
+    return 0xFF;
+}
+
+/**
+ *  @brief hex2bin, one char at a time with range compares
+ *
+ *  @details throws std::runtime_error on a non-hex char
+ */
+void hex2binScalar( char const* hex, size_t numBytes, uint8_t* out )
+{
+    for ( size_t i = 0; i < numBytes; ++i )
+    {
+        uint8_t hi = hexNibbleOrInvalid( hex[i*2] );
+        uint8_t lo = hexNibbleOrInvalid( hex[i*2 + 1] );
+
+        if ( (hi | lo) & 0xF0 )
+        {
+            throw std::runtime_error( "hex2bin(): Invalid hex char" );
+        }
+
+        out[i] = (hi << 4) | lo;
+    }
+}
+
+/**
+ *  @brief hex2bin using a 256 entry lookup table instead of compares
+ *
+ *  @details throws std::runtime_error on a non-hex char. invalid chars are 0xFF
+ *      in the table, so or-ing every nibble together and checking the high bits
+ *      once per block is enough to catch them.
+ */
+void hex2binTable( char const* hex, size_t numBytes, uint8_t* out )
+{
+    static struct Table
+    {
+        uint8_t values[256];
+
+        Table()
+        {
+            for ( int c = 0; c < 256; ++c )
+            {
+                values[c] = hexNibbleOrInvalid( static_cast<char>(c) );
+            }
+        }
+    } const table;
+
+    uint8_t invalid = 0;
+
+    for ( size_t i = 0; i < numBytes; ++i )
+    {
+        uint8_t hi = table.values[static_cast<uint8_t>( hex[i*2] )];
+        uint8_t lo = table.values[static_cast<uint8_t>( hex[i*2 + 1] )];
+
+        invalid |= hi | lo;
+        out[i] = (hi << 4) | lo;
+    }
+
+    if ( invalid & 0xF0 )
+    {
+        throw std::runtime_error( "hex2bin(): Invalid hex char" );
+    }
+}
+
+void singleByteXorScalar( uint8_t const* data, size_t len, uint8_t key, uint8_t* out )
+{
+    for ( size_t i = 0; i < len; ++i )
+    {
+        out[i] = data[i] ^ key;
+    }
+}
+
+void fixedXorScalar( uint8_t const* inp, uint8_t const* key, size_t len, uint8_t* out )
+{
+    for ( size_t i = 0; i < len; ++i )
+    {
+        out[i] = inp[i] ^ key[i];
+    }
+}
+
+#ifdef CRYPTOPALS_X86_KERNELS
+
+__attribute__((target("sse2")))
+void singleByteXorSse2( uint8_t const* data, size_t len, uint8_t key, uint8_t* out )
+{
+    __m128i k = _mm_set1_epi8( static_cast<char>(key) );
+    size_t i = 0;
+
+    for ( ; i + 16 <= len; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128( reinterpret_cast<__m128i const*>(data + i) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(v, k) );
+    }
+
+    singleByteXorScalar( data + i, len - i, key, out + i );
+}
+
+__attribute__((target("avx2")))
+void singleByteXorAvx2( uint8_t const* data, size_t len, uint8_t key, uint8_t* out )
+{
+    __m256i k = _mm256_set1_epi8( static_cast<char>(key) );
+    size_t i = 0;
+
+    for ( ; i + 32 <= len; i += 32 )
+    {
+        __m256i v = _mm256_loadu_si256( reinterpret_cast<__m256i const*>(data + i) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(v, k) );
+    }
+
+    singleByteXorScalar( data + i, len - i, key, out + i );
+}
+
+__attribute__((target("sse2")))
+void fixedXorSse2( uint8_t const* inp, uint8_t const* key, size_t len, uint8_t* out )
+{
+    size_t i = 0;
+
+    for ( ; i + 16 <= len; i += 16 )
+    {
+        __m128i a = _mm_loadu_si128( reinterpret_cast<__m128i const*>(inp + i) );
+        __m128i b = _mm_loadu_si128( reinterpret_cast<__m128i const*>(key + i) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(a, b) );
+    }
+
+    fixedXorScalar( inp + i, key + i, len - i, out + i );
+}
+
+__attribute__((target("avx2")))
+void fixedXorAvx2( uint8_t const* inp, uint8_t const* key, size_t len, uint8_t* out )
+{
+    size_t i = 0;
+
+    for ( ; i + 32 <= len; i += 32 )
+    {
+        __m256i a = _mm256_loadu_si256( reinterpret_cast<__m256i const*>(inp + i) );
+        __m256i b = _mm256_loadu_si256( reinterpret_cast<__m256i const*>(key + i) );
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(a, b) );
+    }
+
+    fixedXorScalar( inp + i, key + i, len - i, out + i );
+}
+
+#endif
+
+/**
+ *  @brief scratch buffers for the benchmarks, so the timed loops dont include
+ *      allocating and filling their inputs
+ *
+ *  @param [in] which which buffer (each caller uses its own)
+ *  @param [in] n     minimum size in bytes
+ *  @return buffer of at least n bytes, filled with hex digits
+ *
+ *  @details hex digits are fine input for every kernel, and it means the
+ *      hex2bin benchmark doesnt trip over invalid chars
+ */
+std::vector<uint8_t>& kernelBenchBuffer( size_t which, size_t n )
+{
+    static std::vector<std::vector<uint8_t>> buffers( 3 );
+
+    std::vector<uint8_t>& buffer = buffers[which];
+
+    if ( buffer.size() < n )
+    {
+        static char const digits[] { "0123456789abcdef" };
+
+        buffer.resize( n );
+
+        for ( size_t i = 0; i < n; ++i )
+        {
+            buffer[i] = digits[(i * 7 + 3) & 0x0F];
+        }
+    }
+
+    return buffer;
+}
+
+/**
+ *  @brief every tunable primitive in the repo
+ *
+ *  @details n/a
+ */
+struct KernelTables
+{
+    KernelDispatch<Hex2BinKernel> hex2bin;
+    KernelDispatch<SingleByteXorKernel> singleByteXor;
+    KernelDispatch<FixedXorKernel> fixedXor;
+
+    KernelTables()
+        : hex2bin( "hex2bin", []( Hex2BinKernel* fn, size_t reps, size_t n )
+          {
+              char const* hex = reinterpret_cast<char const*>( kernelBenchBuffer(0, n*2).data() );
+              uint8_t* out = kernelBenchBuffer( 2, n ).data();
+              for ( size_t r = 0; r < reps; ++r ) { fn( hex, n, out ); }
+          } ),
+          singleByteXor( "singleByteXor", []( SingleByteXorKernel* fn, size_t reps, size_t n )
+          {
+              uint8_t const* data = kernelBenchBuffer( 0, n ).data();
+              uint8_t* out = kernelBenchBuffer( 2, n ).data();
+              for ( size_t r = 0; r < reps; ++r ) { fn( data, n, static_cast<uint8_t>(r), out ); }
+          } ),
+          fixedXor( "fixedXor", []( FixedXorKernel* fn, size_t reps, size_t n )
+          {
+              uint8_t const* inp = kernelBenchBuffer( 0, n ).data();
+              uint8_t const* key = kernelBenchBuffer( 1, n ).data();
+              uint8_t* out = kernelBenchBuffer( 2, n ).data();
+              for ( size_t r = 0; r < reps; ++r ) { fn( inp, key, n, out ); }
+          } )
+    {
+        hex2bin.add( "scalar", hex2binScalar );
+        hex2bin.add( "table", hex2binTable );
+
+        singleByteXor.add( "scalar", singleByteXorScalar );
+        fixedXor.add( "scalar", fixedXorScalar );
+
+#ifdef CRYPTOPALS_X86_KERNELS
+        __builtin_cpu_init();
+
+        bool sse2 = __builtin_cpu_supports( "sse2" );
+        bool avx2 = __builtin_cpu_supports( "avx2" );
+
+        singleByteXor.add( "sse2", singleByteXorSse2, sse2 );
+        singleByteXor.add( "avx2", singleByteXorAvx2, avx2 );
+        fixedXor.add( "sse2", fixedXorSse2, sse2 );
+        fixedXor.add( "avx2", fixedXorAvx2, avx2 );
+#endif
+    }
+
+    std::vector<TunablePrimitive*> all()
+    {
+        return { &hex2bin, &singleByteXor, &fixedXor };
+    }
+};
+
+/**
+ *  @brief the process-wide kernel tables
+ *
+ *  @return kernel tables, set up on first use
+ *
+ *  @details if CRYPTOPALS_KERNEL_PROFILE is set, the profile at that path (as
+ *      written by tools/autotune.cpp) gets loaded the first time through. the
+ *      profile is only a hint: a missing file means we stick with the defaults,
+ *      and a broken one gets a warning on stderr and is otherwise ignored.
+ */
+KernelTables& kernels()
+{
+    static KernelTables tables;
+    static bool profileLoaded = [&]
+    {
+        char const* path = std::getenv( "CRYPTOPALS_KERNEL_PROFILE" );
+
+        if ( path == nullptr )
+        {
+            return false;
+        }
+
+        try
+        {
+            return loadKernelProfile( path, tables.all() );
+        }
+        catch ( std::exception const& e )
+        {
+            std::cerr << "warning: ignoring kernel profile " << path << ": " << e.what() << std::endl;
+            return false;
+        }
+    }();
+
+    (void)profileLoaded;
+
+    return tables;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#include "conversions.hpp"
+
+#ifndef RESULT_WRITER_HPP
+#define RESULT_WRITER_HPP
+
+/**
+ *  @brief buffers rendered output lines and hands them to write(2) in big chunks
+ *
+ *  @details going through std::cout/std::endl once per decrypted line means a
+ *      flush (and a syscall) per line, which is way slower than the actual
+ *      decryption once you are printing millions of them. this collects records
+ *      into one buffer and only writes when it fills up, on flush(), or when
+ *      the writer goes out of scope.
+ */
+class ResultWriter
+{
+public:
+    /**
+     *  @brief sets up a writer on an already open file descriptor
+     *
+     *  @param [in] fd       file descriptor to write to (not closed by us)
+     *  @param [in] capacity size of the output buffer in bytes
+     *
+     *  @details n/a
+     */
+    explicit ResultWriter( int fd = STDOUT_FILENO, size_t capacity = 1 << 20 )
+        : m_fd( fd ), m_buffer( capacity ), m_used( 0 )
+    {
+        if ( capacity == 0 )
+        {
+            throw std::runtime_error( "ResultWriter(): Buffer capacity must be nonzero" );
+        }
+    }
+
+    ResultWriter( ResultWriter const& ) = delete;
+    ResultWriter& operator=( ResultWriter const& ) = delete;
+
+    ~ResultWriter()
+    {
+        // cant throw out of a destructor, so anything that fails here is lost.
+        // call flush() yourself if you care about the error.
+        try
+        {
+            flush();
+        }
+        catch ( ... )
+        {
+        }
+    }
+
+    /**
+     *  @brief appends raw bytes to the buffer as-is
+     *
+     *  @param [in] data pointer to the bytes to write
+     *  @param [in] len  number of bytes
+     *
+     *  @details anything bigger than the buffer skips it and goes straight out
+     */
+    void write( char const* data, size_t len )
+    {
+        if ( len > m_buffer.size() - m_used )
+        {
+            flush();
+        }
+
+        if ( len > m_buffer.size() )
+        {
+            writeAll( data, len );
+            return;
+        }
+
+        std::memcpy( m_buffer.data() + m_used, data, len );
+        m_used += len;
+    }
+
+    /**
+     *  @brief renders a byte array as printable text and appends it plus a newline
+     *
+     *  @param [in] data  byte array to render
+     *  @param [in] style escape style for non-printable bytes
+     *
+     *  @details renders straight into the output buffer when it fits, so there
+     *      is no temporary string per record
+     */
+    void writeRecord( std::vector<uint8_t> const& data, EscapeStyle style )
+    {
+        size_t size = renderedSize( data.data(), data.size(), style ) + 1;
+
+        if ( size > m_buffer.size() - m_used )
+        {
+            flush();
+        }
+
+        if ( size > m_buffer.size() )
+        {
+            std::string rendered = renderPrintable( data, style );
+            rendered += '\n';
+            writeAll( rendered.data(), rendered.size() );
+            return;
+        }
+
+        m_used += renderPrintable( data.data(), data.size(), style, m_buffer.data() + m_used );
+        m_buffer[m_used++] = '\n';
+    }
+
+    /**
+     *  @brief writes out everything that is currently buffered
+     *
+     *  @details throws std::runtime_error if write(2) fails
+     */
+    void flush()
+    {
+        size_t used = m_used;
+
+        // reset before writing so a failed write doesnt get retried from
+        // the destructor with the same data
+        m_used = 0;
+
+        writeAll( m_buffer.data(), used );
+    }
+
+private:
+    /**
+     *  @brief loops on write(2) until all of data is out
+     *
+     *  @param [in] data pointer to the bytes to write
+     *  @param [in] len  number of bytes
+     *
+     *  @details retries on EINTR and short writes, throws on anything else
+     */
+    void writeAll( char const* data, size_t len )
+    {
+        while ( len > 0 )
+        {
+            ssize_t written = ::write( m_fd, data, len );
+
+            if ( written < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+
+                throw std::runtime_error( std::string("ResultWriter::writeAll(): write failed: ") + std::strerror(errno) );
+            }
+
+            data += written;
+            len -= written;
+        }
+    }
+
+    int m_fd;
+    std::vector<char> m_buffer;
+    size_t m_used;
+};
+
+#endif
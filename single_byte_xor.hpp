@@ -16,12 +16,9 @@
  */
 std::vector<uint8_t> singleByteXor( std::vector<uint8_t> data, uint8_t key )
 {
-    std::vector<uint8_t> output {};
+    std::vector<uint8_t> output( data.size() );
     
-    for ( int i = 0; i < data.size(); ++i )
-    {
-        output.push_back( data[i] ^ key );
-    }
+    kernels().singleByteXor.select( data.size() )( data.data(), data.size(), key, output.data() );
     
     return output;
 }
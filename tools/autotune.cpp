@@ -0,0 +1,31 @@
+#include <iostream>
+
+#include "../kernels.hpp"
+
+int main( int argc, char** argv )
+{
+    // benchmarks every kernel variant this machine supports, in every size bucket,
+    // and writes the winners out to a profile file.
+    //
+    // usage: autotune [profile path]   (defaults to kernels.profile)
+    //
+    // point CRYPTOPALS_KERNEL_PROFILE at the file and kernels() will load it on
+    // startup. profiles only make sense for the machine they were made on, so
+    // run this once per host (or per hardware type).
+
+    std::string path = (argc > 1) ? argv[1] : "kernels.profile";
+
+    // build our own tables instead of going through kernels(), so we start from
+    // the defaults and never look at whatever profile CRYPTOPALS_KERNEL_PROFILE
+    // currently points at. that might be the (broken, stale) file we are about
+    // to overwrite.
+    KernelTables tables;
+
+    autotuneKernels( tables.all(), &std::cout );
+
+    saveKernelProfile( path, tables.all() );
+
+    std::cout << "Wrote profile to " << path << std::endl;
+
+    return 0;
+}